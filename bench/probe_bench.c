@@ -0,0 +1,185 @@
+// Copyright (c) 2023 dyphire. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+// Measures display-list refresh time against display count. The plugin is
+// compiled into this program so update_display_list(), the function the probe
+// worker runs for every refresh, is timed unchanged: probing, the pool join,
+// compaction, fragment rendering and publishing to a headless mpv core. The
+// driver calls go to a synthetic backend that sleeps for a fixed time per call.
+
+#include "display.c"
+
+#include <mmsystem.h>
+
+#define MAX_DISPLAYS 8
+#define ROUNDS 5
+
+// Simulated latency of each per-display driver call, in ms
+#define MONITOR_NAME_MS 2
+#define HDR_STATUS_MS 2
+#define OUTPUT_DESC_MS 12
+#define SOURCE_NAME_MS 2
+
+static UINT32 g_bench_displays = 0;
+static volatile LONG g_bench_round = 0;
+
+static bool synthetic_query_config(DISPLAYCONFIG_PATH_INFO **outPaths, UINT32 *outPathCount,
+                                   DISPLAYCONFIG_MODE_INFO **outModes, UINT32 *outModeCount) {
+    UINT32 count = g_bench_displays;
+    DISPLAYCONFIG_PATH_INFO *paths = calloc(count ? count : 1, sizeof(*paths));
+    DISPLAYCONFIG_MODE_INFO *modes = calloc(count ? count * 2 : 1, sizeof(*modes));
+    if (!paths || !modes) {
+        free(paths);
+        free(modes);
+        return false;
+    }
+
+    for (UINT32 i = 0; i < count; i++) {
+        LUID adapter = { .LowPart = 1 };
+        DISPLAYCONFIG_PATH_INFO *path = &paths[i];
+        path->sourceInfo.adapterId = adapter;
+        path->sourceInfo.id = i;
+        path->targetInfo.adapterId = adapter;
+        path->targetInfo.id = 100 + i;
+        path->targetInfo.outputTechnology = DISPLAYCONFIG_OUTPUT_TECHNOLOGY_DISPLAYPORT_EXTERNAL;
+        path->targetInfo.refreshRate.Numerator = 60000;
+        path->targetInfo.refreshRate.Denominator = 1001;
+
+        DISPLAYCONFIG_MODE_INFO *src = &modes[i * 2];
+        src->infoType = DISPLAYCONFIG_MODE_INFO_TYPE_SOURCE;
+        src->id = i;
+        src->adapterId = adapter;
+        src->sourceMode.width = 3840;
+        src->sourceMode.height = 2160;
+        src->sourceMode.position.x = (LONG)(i * 3840);
+
+        DISPLAYCONFIG_MODE_INFO *target = &modes[i * 2 + 1];
+        target->infoType = DISPLAYCONFIG_MODE_INFO_TYPE_TARGET;
+        target->id = 100 + i;
+        target->adapterId = adapter;
+    }
+
+    *outPaths = paths;
+    *outPathCount = count;
+    *outModes = modes;
+    *outModeCount = count * 2;
+    return true;
+}
+
+static HMONITOR synthetic_path_monitor(const DISPLAYCONFIG_PATH_INFO *path, DISPLAYCONFIG_MODE_INFO *modes, UINT32 modeCount) {
+    return (HMONITOR)(uintptr_t)(path->sourceInfo.id + 1);
+}
+
+static void synthetic_monitor_name(const DISPLAYCONFIG_MODE_INFO *mode, char *out, size_t outlen) {
+    Sleep(MONITOR_NAME_MS);
+    snprintf(out, outlen, "Synthetic \"Monitor\" %u", mode->id - 100);
+}
+
+static HDR_STATUS synthetic_hdr_status(const DISPLAYCONFIG_MODE_INFO *mode, UINT32 *outBitDepth) {
+    Sleep(HDR_STATUS_MS);
+    *outBitDepth = 10;
+    return HDR_STATUS_ON;
+}
+
+// Luminance moves every round so each refresh re-renders every fragment
+static bool synthetic_output_desc(HMONITOR hMon, DXGI_OUTPUT_DESC1 *out_desc) {
+    Sleep(OUTPUT_DESC_MS);
+    *out_desc = (DXGI_OUTPUT_DESC1){
+        .Monitor = hMon,
+        .ColorSpace = DXGI_COLOR_SPACE_RGB_FULL_G2084_NONE_P2020,
+        .MaxLuminance = 1000.0f + g_bench_round,
+        .MinLuminance = 0.01f,
+        .MaxFullFrameLuminance = 600.0f,
+    };
+    return true;
+}
+
+static bool synthetic_source_name(const DISPLAYCONFIG_PATH_INFO *path, wchar_t *out, size_t outlen) {
+    Sleep(SOURCE_NAME_MS);
+    swprintf(out, outlen, L"\\\\.\\DISPLAY%u", path->sourceInfo.id + 1);
+    return true;
+}
+
+static const probe_backend synthetic_probe_backend = {
+    .query_config = synthetic_query_config,
+    .path_monitor = synthetic_path_monitor,
+    .monitor_name = synthetic_monitor_name,
+    .hdr_status = synthetic_hdr_status,
+    .output_desc = synthetic_output_desc,
+    .source_name = synthetic_source_name,
+};
+
+// The published list must hold every display, in path order
+static bool check_published_list(UINT32 displays) {
+    char *json = mpv_get_property_string(mpv, "user-data/display-list/full");
+    if (!json)
+        return false;
+
+    bool ok = true;
+    const char *p = json;
+    for (UINT32 i = 0; i < displays && ok; i++) {
+        char uid[32];
+        snprintf(uid, sizeof(uid), "\"uid\":\"%u\"", 100 + i);
+        p = strstr(p, uid);
+        ok = p != NULL;
+    }
+    if (ok && displays < MAX_DISPLAYS) {
+        char uid[32];
+        snprintf(uid, sizeof(uid), "\"uid\":\"%u\"", 100 + displays);
+        ok = strstr(json, uid) == NULL;
+    }
+
+    mpv_free(json);
+    return ok;
+}
+
+static double run_refresh_ms(UINT32 displays, int workers) {
+    LARGE_INTEGER freq, start, end;
+    QueryPerformanceFrequency(&freq);
+
+    g_bench_displays = displays;
+    g_probe_workers = workers;
+
+    double best = 0.0;
+    for (int round = 0; round < ROUNDS; round++) {
+        uint64_t generation = (uint64_t)InterlockedIncrement(&g_bench_round);
+
+        QueryPerformanceCounter(&start);
+        update_display_list(generation);
+        QueryPerformanceCounter(&end);
+
+        if (!check_published_list(displays)) {
+            fprintf(stderr, "published list is wrong for %u displays\n", displays);
+            exit(1);
+        }
+
+        double ms = (end.QuadPart - start.QuadPart) * 1000.0 / freq.QuadPart;
+        if (round == 0 || ms < best)
+            best = ms;
+    }
+    return best;
+}
+
+int main(void) {
+    mpv = mpv_create();
+    if (!mpv || mpv_initialize(mpv) < 0) {
+        fprintf(stderr, "failed to create mpv core\n");
+        return 1;
+    }
+
+    g_probe_backend = &synthetic_probe_backend;
+
+    // Sleep granularity defaults to the 15.6 ms system tick
+    timeBeginPeriod(1);
+
+    printf("displays  serial_ms  pool_ms  speedup\n");
+    for (UINT32 displays = 1; displays <= MAX_DISPLAYS; displays++) {
+        double serial = run_refresh_ms(displays, 1);
+        double pooled = run_refresh_ms(displays, POOL_MAX_WORKERS);
+        printf("%8u  %9.1f  %7.1f  %6.2fx\n", displays, serial, pooled, serial / pooled);
+    }
+
+    timeEndPeriod(1);
+    mpv_terminate_destroy(mpv);
+    return 0;
+}
@@ -11,6 +11,9 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <math.h>
+
+#include "pool.h"
 
 #define INITGUID
 #include <dxgi1_6.h> 
@@ -377,216 +380,954 @@ static bool get_dxgi_output_desc1_for_monitor(HMONITOR hMon, DXGI_OUTPUT_DESC1 *
     return found_match;
 }
 
-static void update_display_list() {
-    HMONITOR current_monitor = GetWindowMonitor(hwnd);
+// Growable output buffer for the display-list JSON. Once an allocation fails
+// the writer is marked failed and ignores further writes, so a truncated
+// document is never mistaken for a complete one.
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+    bool failed;
+} json_writer;
+
+static bool json_reserve(json_writer *w, size_t extra) {
+    if (w->failed)
+        return false;
+    if (w->len + extra + 1 <= w->cap)
+        return true;
+
+    size_t cap = w->cap ? w->cap : 256;
+    while (cap < w->len + extra + 1)
+        cap *= 2;
 
+    char *data = realloc(w->data, cap);
+    if (!data) {
+        mpv_print("Memory allocation failed");
+        w->failed = true;
+        return false;
+    }
+    w->data = data;
+    w->cap = cap;
+    return true;
+}
+
+static void json_free(json_writer *w) {
+    free(w->data);
+    *w = (json_writer){0};
+}
+
+static void json_raw(json_writer *w, const char *s, size_t n) {
+    if (!json_reserve(w, n)) return;
+    memcpy(w->data + w->len, s, n);
+    w->len += n;
+    w->data[w->len] = '\0';
+}
+
+static void json_raw_str(json_writer *w, const char *s) {
+    json_raw(w, s, strlen(s));
+}
+
+static const char *json_str(const json_writer *w) {
+    return w->data ? w->data : "";
+}
+
+// Emits a separator unless the previous token opened a container or was a key
+static void json_sep(json_writer *w) {
+    if (w->len == 0) return;
+    char last = w->data[w->len - 1];
+    if (last != '{' && last != '[' && last != ':')
+        json_raw(w, ",", 1);
+}
+
+static void json_write_string(json_writer *w, const char *s) {
+    json_raw(w, "\"", 1);
+    const char *run = s;
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+
+        json_raw(w, run, (size_t)(s - run));
+        run = s + 1;
+
+        char esc[8];
+        switch (c) {
+            case '"':  json_raw(w, "\\\"", 2); break;
+            case '\\': json_raw(w, "\\\\", 2); break;
+            case '\b': json_raw(w, "\\b", 2); break;
+            case '\f': json_raw(w, "\\f", 2); break;
+            case '\n': json_raw(w, "\\n", 2); break;
+            case '\r': json_raw(w, "\\r", 2); break;
+            case '\t': json_raw(w, "\\t", 2); break;
+            default:
+                snprintf(esc, sizeof(esc), "\\u%04x", c);
+                json_raw_str(w, esc);
+                break;
+        }
+    }
+    json_raw(w, run, (size_t)(s - run));
+    json_raw(w, "\"", 1);
+}
+
+// Fixed-point formatting built from integer conversions only, so the output
+// never picks up a decimal comma from the process locale.
+static void format_fixed(char *out, size_t outlen, double v, int decimals) {
+    static const uint64_t scale[] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+    if (decimals < 0) decimals = 0;
+    if (decimals > 6) decimals = 6;
+    if (!isfinite(v)) v = 0.0;
+    if (v > 1e12) v = 1e12;
+    if (v < -1e12) v = -1e12;
+
+    bool neg = v < 0;
+    uint64_t scaled = (uint64_t)((neg ? -v : v) * scale[decimals] + 0.5);
+    uint64_t ipart = scaled / scale[decimals];
+    uint64_t fpart = scaled % scale[decimals];
+    neg = neg && scaled != 0;
+
+    if (decimals == 0)
+        snprintf(out, outlen, "%s%llu", neg ? "-" : "", (unsigned long long)ipart);
+    else
+        snprintf(out, outlen, "%s%llu.%0*llu", neg ? "-" : "", (unsigned long long)ipart,
+                 decimals, (unsigned long long)fpart);
+}
+
+static void json_begin_object(json_writer *w) {
+    json_sep(w);
+    json_raw(w, "{", 1);
+}
+
+static void json_end_object(json_writer *w) {
+    json_raw(w, "}", 1);
+}
+
+static void json_key(json_writer *w, const char *key) {
+    json_sep(w);
+    json_write_string(w, key);
+    json_raw(w, ":", 1);
+}
+
+static void json_kv_string(json_writer *w, const char *key, const char *value) {
+    json_key(w, key);
+    json_write_string(w, value);
+}
+
+static void json_kv_bool(json_writer *w, const char *key, bool value) {
+    json_key(w, key);
+    json_raw_str(w, value ? "true" : "false");
+}
+
+static void json_kv_uint(json_writer *w, const char *key, uint32_t value) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u", value);
+    json_key(w, key);
+    json_raw_str(w, buf);
+}
+
+static void json_kv_fixed(json_writer *w, const char *key, double value, int decimals) {
+    char buf[48];
+    format_fixed(buf, sizeof(buf), value, decimals);
+    json_key(w, key);
+    json_raw_str(w, buf);
+}
+
+// Everything published about a single display
+typedef struct {
+    LUID adapter_id;
+    UINT32 target_id;
+    char name[128];
+    char uid[16];
+    bool current;
+    HDR_STATUS hdr_status;
+    UINT32 width;
+    UINT32 height;
+    float refresh_rate;
+    UINT32 bit_depth;
+    const char *primaries;
+    const char *transfer;
+    float max_luminance;
+    float min_luminance;
+    float max_full_frame_luminance;
+    const char *technology;
+} display_record;
+
+// A display record together with its rendered JSON object
+typedef struct {
+    display_record record;
+    json_writer fragment;
+} display_entry;
+
+// Last published display table, guarded by g_display_lock since updates run
+// on both the mpv event thread and the message window thread.
+static SRWLOCK g_display_lock = SRWLOCK_INIT;
+static display_entry *g_displays = NULL;
+static size_t g_display_count = 0;
+
+// Driver calls made while refreshing, tracked per worker so a missed deadline
+// can be attributed to the calls that were still running
+typedef enum {
+    PROBE_NONE,
+    PROBE_QUERY_CONFIG,
+    PROBE_MONITOR_NAME,
+    PROBE_HDR_STATUS,
+    PROBE_DXGI_OUTPUT,
+    PROBE_SOURCE_NAME,
+    PROBE_HDR_TOGGLE,
+    PROBE_COUNT
+} probe_kind;
+
+static const char *const probe_names[PROBE_COUNT] = {
+    [PROBE_QUERY_CONFIG] = "query_display_config",
+    [PROBE_MONITOR_NAME] = "monitor_name",
+    [PROBE_HDR_STATUS] = "hdr_status",
+    [PROBE_DXGI_OUTPUT] = "dxgi_output",
+    [PROBE_SOURCE_NAME] = "source_name",
+    [PROBE_HDR_TOGGLE] = "hdr_toggle",
+};
+
+// Worker 0 is the probe thread itself, the others are pool helpers
+static volatile LONG g_probe_stages[POOL_MAX_WORKERS];
+static uint32_t g_probe_timeouts[PROBE_COUNT];
+
+static void set_probe_stage(int worker, probe_kind kind) {
+    InterlockedExchange(&g_probe_stages[worker], kind);
+}
+
+static bool display_record_equal(const display_record *a, const display_record *b) {
+    return a->current == b->current &&
+           a->hdr_status == b->hdr_status &&
+           a->width == b->width &&
+           a->height == b->height &&
+           a->refresh_rate == b->refresh_rate &&
+           a->bit_depth == b->bit_depth &&
+           a->max_luminance == b->max_luminance &&
+           a->min_luminance == b->min_luminance &&
+           a->max_full_frame_luminance == b->max_full_frame_luminance &&
+           strcmp(a->name, b->name) == 0 &&
+           strcmp(a->uid, b->uid) == 0 &&
+           strcmp(a->primaries, b->primaries) == 0 &&
+           strcmp(a->transfer, b->transfer) == 0 &&
+           strcmp(a->technology, b->technology) == 0;
+}
+
+static display_entry *find_cached_display(const display_record *r) {
+    for (size_t i = 0; i < g_display_count; i++) {
+        display_record *c = &g_displays[i].record;
+        if (c->target_id == r->target_id &&
+            c->adapter_id.HighPart == r->adapter_id.HighPart &&
+            c->adapter_id.LowPart == r->adapter_id.LowPart)
+            return &g_displays[i];
+    }
+    return NULL;
+}
+
+static void render_display_fragment(const display_record *r, json_writer *w) {
+    w->len = 0;
+    w->failed = false;
+    json_begin_object(w);
+    json_kv_string(w, "name", r->name);
+    json_kv_string(w, "uid", r->uid);
+    json_kv_bool(w, "current", r->current);
+    json_kv_bool(w, "hdr_supported", r->hdr_status != HDR_STATUS_UNSUPPORTED);
+    json_kv_string(w, "hdr_status", hdr_status_to_str(r->hdr_status));
+    json_kv_uint(w, "width", r->width);
+    json_kv_uint(w, "height", r->height);
+    json_kv_fixed(w, "refresh_rate", r->refresh_rate, 2);
+    json_kv_uint(w, "bit_depth", r->bit_depth);
+    json_kv_string(w, "primaries", r->primaries);
+    json_kv_string(w, "transfer", r->transfer);
+    json_kv_fixed(w, "max_luminance", r->max_luminance, 2);
+    json_kv_fixed(w, "min_luminance", r->min_luminance, 4);
+    json_kv_fixed(w, "max_full_frame_luminance", r->max_full_frame_luminance, 4);
+    json_kv_string(w, "technology", r->technology);
+    json_end_object(w);
+}
+
+static const char *output_technology_to_str(DISPLAYCONFIG_VIDEO_OUTPUT_TECHNOLOGY tech) {
+    switch (tech) {
+        case DISPLAYCONFIG_OUTPUT_TECHNOLOGY_HDMI: return "HDMI";
+        case DISPLAYCONFIG_OUTPUT_TECHNOLOGY_DISPLAYPORT_EXTERNAL: return "DisplayPort";
+        case DISPLAYCONFIG_OUTPUT_TECHNOLOGY_DISPLAYPORT_EMBEDDED: return "eDP";
+        case DISPLAYCONFIG_OUTPUT_TECHNOLOGY_DVI: return "DVI";
+        case DISPLAYCONFIG_OUTPUT_TECHNOLOGY_INTERNAL: return "Internal";
+        default: return "Unknown";
+    }
+}
+
+// Queries the active paths and modes, the arrays are owned by the caller
+static bool query_active_display_config(DISPLAYCONFIG_PATH_INFO **outPaths, UINT32 *outPathCount,
+                                        DISPLAYCONFIG_MODE_INFO **outModes, UINT32 *outModeCount) {
     UINT32 pathCount = 0, modeCount = 0;
     if (GetDisplayConfigBufferSizes(QDC_ONLY_ACTIVE_PATHS, &pathCount, &modeCount) != ERROR_SUCCESS)
-        return;
+        return false;
 
     DISPLAYCONFIG_PATH_INFO *paths = calloc(pathCount, sizeof(*paths));
     DISPLAYCONFIG_MODE_INFO *modes = calloc(modeCount, sizeof(*modes));
-    if (!paths || !modes) {
+    if (!paths || !modes ||
+        QueryDisplayConfig(QDC_ONLY_ACTIVE_PATHS, &pathCount, paths, &modeCount, modes, NULL) != ERROR_SUCCESS) {
         free(paths);
         free(modes);
-        return;
+        return false;
     }
 
-    if (QueryDisplayConfig(QDC_ONLY_ACTIVE_PATHS, &pathCount, paths, &modeCount, modes, NULL) != ERROR_SUCCESS) {
-        free(paths);
-        free(modes);
+    *outPaths = paths;
+    *outPathCount = pathCount;
+    *outModes = modes;
+    *outModeCount = modeCount;
+    return true;
+}
+
+static bool get_source_gdi_name(const DISPLAYCONFIG_PATH_INFO *path, wchar_t *out, size_t outlen) {
+    DISPLAYCONFIG_SOURCE_DEVICE_NAME sourceName = {
+        .header = {
+            .type = DISPLAYCONFIG_DEVICE_INFO_GET_SOURCE_NAME,
+            .size = sizeof(sourceName),
+            .adapterId = path->sourceInfo.adapterId,
+            .id = path->sourceInfo.id
+        }
+    };
+    if (DisplayConfigGetDeviceInfo(&sourceName.header) != ERROR_SUCCESS)
+        return false;
+
+    wcsncpy_s(out, outlen, sourceName.viewGdiDeviceName, _TRUNCATE);
+    return true;
+}
+
+// Driver queries made by a display refresh. The Win32 backend is the only one
+// the plugin uses, the benchmark swaps in a synthetic one.
+typedef struct {
+    bool (*query_config)(DISPLAYCONFIG_PATH_INFO **paths, UINT32 *pathCount,
+                         DISPLAYCONFIG_MODE_INFO **modes, UINT32 *modeCount);
+    HMONITOR (*path_monitor)(const DISPLAYCONFIG_PATH_INFO *path, DISPLAYCONFIG_MODE_INFO *modes, UINT32 modeCount);
+    void (*monitor_name)(const DISPLAYCONFIG_MODE_INFO *mode, char *out, size_t outlen);
+    HDR_STATUS (*hdr_status)(const DISPLAYCONFIG_MODE_INFO *mode, UINT32 *outBitDepth);
+    bool (*output_desc)(HMONITOR hMon, DXGI_OUTPUT_DESC1 *out_desc);
+    bool (*source_name)(const DISPLAYCONFIG_PATH_INFO *path, wchar_t *out, size_t outlen);
+} probe_backend;
+
+static const probe_backend win32_probe_backend = {
+    .query_config = query_active_display_config,
+    .path_monitor = get_hm_from_display_path,
+    .monitor_name = GetMonitorName,
+    .hdr_status = GetDisplayHDRStatusAndBitDepth,
+    .output_desc = get_dxgi_output_desc1_for_monitor,
+    .source_name = get_source_gdi_name,
+};
+
+static const probe_backend *g_probe_backend = &win32_probe_backend;
+static int g_probe_workers = POOL_MAX_WORKERS;
+
+// Fills a display record for one active path, returns false if the path has no usable target
+static bool probe_display(int worker, const DISPLAYCONFIG_PATH_INFO *path, DISPLAYCONFIG_MODE_INFO *modes, UINT32 modeCount,
+                          const wchar_t *current_device, display_record *out) {
+    const probe_backend *backend = g_probe_backend;
+    HMONITOR hMonitor = backend->path_monitor(path, modes, modeCount);
+    if (!hMonitor) return false;
+
+    DISPLAYCONFIG_MODE_INFO *mode = NULL;
+    for (UINT32 j = 0; j < modeCount; j++) {
+        if (modes[j].infoType == DISPLAYCONFIG_MODE_INFO_TYPE_TARGET &&
+            modes[j].id == path->targetInfo.id &&
+            modes[j].adapterId.HighPart == path->targetInfo.adapterId.HighPart &&
+            modes[j].adapterId.LowPart == path->targetInfo.adapterId.LowPart) {
+            mode = &modes[j];
+            break;
+        }
+    }
+    if (!mode) return false;
+
+    *out = (display_record){
+        .adapter_id = mode->adapterId,
+        .target_id = mode->id,
+        .primaries = "Unknown",
+        .transfer = "Unknown",
+        .technology = output_technology_to_str(path->targetInfo.outputTechnology),
+    };
+
+    snprintf(out->uid, sizeof(out->uid), "%u", mode->id);
+
+    set_probe_stage(worker, PROBE_MONITOR_NAME);
+    backend->monitor_name(mode, out->name, sizeof(out->name));
+    if (out->name[0] == '\0')
+        snprintf(out->name, sizeof(out->name), "Unknown");
+
+    set_probe_stage(worker, PROBE_HDR_STATUS);
+    out->hdr_status = backend->hdr_status(mode, &out->bit_depth);
+
+    for (UINT32 k = 0; k < modeCount; k++) {
+        if (modes[k].infoType == DISPLAYCONFIG_MODE_INFO_TYPE_SOURCE &&
+            modes[k].id == path->sourceInfo.id &&
+            modes[k].adapterId.HighPart == path->sourceInfo.adapterId.HighPart &&
+            modes[k].adapterId.LowPart == path->sourceInfo.adapterId.LowPart) {
+            DISPLAYCONFIG_SOURCE_MODE *src = &modes[k].sourceMode;
+            out->width = src->width;
+            out->height = src->height;
+            if (path->targetInfo.refreshRate.Denominator != 0)
+                out->refresh_rate = path->targetInfo.refreshRate.Numerator / (float)path->targetInfo.refreshRate.Denominator;
+            break;
+        }
+    }
+
+    set_probe_stage(worker, PROBE_DXGI_OUTPUT);
+    DXGI_OUTPUT_DESC1 dxgi_desc1;
+    if (backend->output_desc(hMonitor, &dxgi_desc1)) {
+        out->max_luminance = dxgi_desc1.MaxLuminance;
+        out->min_luminance = dxgi_desc1.MinLuminance;
+        out->max_full_frame_luminance = dxgi_desc1.MaxFullFrameLuminance;
+        out->primaries = dxgi_primaries_to_str_local(dxgi_desc1.ColorSpace);
+        out->transfer = dxgi_transfer_to_str_local(dxgi_desc1.ColorSpace);
+        mpv_print("DXGI Info: MaxL:%.2f, MinL:%.4f, Prim:%s, Trans:%s",
+                  out->max_luminance, out->min_luminance, out->primaries, out->transfer);
+    } else {
+        mpv_print("Failed to get DXGI_OUTPUT_DESC1 for monitor.");
+    }
+
+    if (current_device) {
+        wchar_t source_device[32];
+        set_probe_stage(worker, PROBE_SOURCE_NAME);
+        if (backend->source_name(path, source_device, sizeof(source_device) / sizeof(source_device[0])))
+            out->current = wcscmp(current_device, source_device) == 0;
+    }
+
+    return true;
+}
+
+static void publish_current_display(const display_record *r) {
+    mpv_set_property_string(mpv, "user-data/display-info/name", r->name);
+    mpv_set_property_string(mpv, "user-data/display-info/uid", r->uid);
+    mpv_set_property_string(mpv, "user-data/display-info/hdr-supported", (r->hdr_status == HDR_STATUS_UNSUPPORTED) ? "false" : "true");
+    mpv_set_property_string(mpv, "user-data/display-info/hdr-status", hdr_status_to_str(r->hdr_status));
+
+    char temp_str[48];
+    snprintf(temp_str, sizeof(temp_str), "%u", r->bit_depth);
+    mpv_set_property_string(mpv, "user-data/display-info/bit-depth", temp_str);
+    format_fixed(temp_str, sizeof(temp_str), r->refresh_rate, 2);
+    mpv_set_property_string(mpv, "user-data/display-info/refresh-rate", temp_str);
+    format_fixed(temp_str, sizeof(temp_str), r->max_luminance, 2);
+    mpv_set_property_string(mpv, "user-data/display-info/max-luminance", temp_str);
+    format_fixed(temp_str, sizeof(temp_str), r->min_luminance, 4);
+    mpv_set_property_string(mpv, "user-data/display-info/min-luminance", temp_str);
+    format_fixed(temp_str, sizeof(temp_str), r->max_full_frame_luminance, 4);
+    mpv_set_property_string(mpv, "user-data/display-info/max-full-frame-luminance", temp_str);
+    mpv_set_property_string(mpv, "user-data/display-info/primaries", r->primaries);
+    mpv_set_property_string(mpv, "user-data/display-info/transfer", r->transfer);
+
+    mpv_print("Display: %s, HDR: %s", r->name, hdr_status_to_str(r->hdr_status));
+}
+
+// Plugin options, read from script-opts with the "display-info-" prefix
+typedef struct {
+    bool apply_targets;
+    double target_tolerance;
+    DWORD probe_timeout_ms;
+} plugin_opts;
+
+static const plugin_opts default_opts = {
+    .apply_targets = false,
+    .target_tolerance = 0.01,
+    .probe_timeout_ms = 1000,
+};
+
+static plugin_opts g_opts = default_opts;
+
+// Renderer targets derived from a display record, a value of 0 means "auto"
+typedef struct {
+    double peak;
+    double contrast;
+    const char *prim;
+    const char *trc;
+} tone_mapping_targets;
+
+// Last targets written to mpv, used to skip writes that would only rebuild shaders
+static tone_mapping_targets g_applied_targets;
+static char g_applied_uid[16];
+static bool g_targets_applied = false;
+
+// The options as they were before the plugin first wrote them, restored when
+// the mode is switched off so values from mpv.conf survive
+static const char *const target_options[] = { "target-peak", "target-contrast", "target-prim", "target-trc" };
+#define TARGET_OPTION_COUNT (sizeof(target_options) / sizeof(target_options[0]))
+static char g_saved_targets[TARGET_OPTION_COUNT][48];
+static bool g_targets_saved = false;
+
+static void save_user_targets() {
+    for (size_t i = 0; i < TARGET_OPTION_COUNT; i++) {
+        char *value = mpv_get_property_string(mpv, target_options[i]);
+        snprintf(g_saved_targets[i], sizeof(g_saved_targets[i]), "%s", value ? value : "");
+        mpv_free(value);
+    }
+    g_targets_saved = true;
+}
+
+static tone_mapping_targets derive_tone_mapping_targets(const display_record *r) {
+    tone_mapping_targets t = { .prim = "auto", .trc = "auto" };
+
+    // mpv only accepts target-peak in [10, 10000] and target-contrast in [10, 1000000]
+    if (r->hdr_status == HDR_STATUS_ON && r->max_luminance >= 10.0f)
+        t.peak = fmin(r->max_luminance, 10000.0);
+    if (r->max_luminance > 0.0f && r->min_luminance > 0.0f)
+        t.contrast = fmax(10.0, fmin(r->max_luminance / r->min_luminance, 1000000.0));
+
+    if (strcmp(r->primaries, "BT.709") == 0)
+        t.prim = "bt.709";
+    else if (strcmp(r->primaries, "BT.2020") == 0)
+        t.prim = "bt.2020";
+
+    if (strcmp(r->transfer, "sRGB") == 0)
+        t.trc = "srgb";
+    else if (strcmp(r->transfer, "Linear") == 0)
+        t.trc = "linear";
+    else if (strcmp(r->transfer, "PQ") == 0)
+        t.trc = "pq";
+
+    return t;
+}
+
+static bool target_value_changed(double applied, double derived) {
+    if ((applied == 0.0) != (derived == 0.0))
+        return true;
+    return fabs(applied - derived) > g_opts.target_tolerance * fmax(applied, derived);
+}
+
+static void append_set_target(char *cmd, size_t cmdlen, const char *option, const char *value) {
+    size_t len = strlen(cmd);
+    snprintf(cmd + len, cmdlen - len, "%sno-osd set %s %s", len ? ";" : "", option, value);
+}
+
+static void append_set_target_number(char *cmd, size_t cmdlen, const char *option, double value) {
+    char buf[48] = "auto";
+    if (value > 0.0)
+        format_fixed(buf, sizeof(buf), value, 0);
+    append_set_target(cmd, cmdlen, option, buf);
+}
+
+// Pushes the derived targets into mpv's options. Every changed option goes out
+// in a single command list, and a refresh that changes nothing writes nothing.
+static void apply_tone_mapping_targets(const display_record *r) {
+    if (!g_opts.apply_targets)
         return;
+
+    if (!g_targets_saved)
+        save_user_targets();
+
+    tone_mapping_targets t = derive_tone_mapping_targets(r);
+    tone_mapping_targets *a = &g_applied_targets;
+    bool all = !g_targets_applied;
+
+    char cmd[512] = "";
+    if (all || target_value_changed(a->peak, t.peak)) {
+        append_set_target_number(cmd, sizeof(cmd), "target-peak", t.peak);
+        a->peak = t.peak;
+    }
+    if (all || target_value_changed(a->contrast, t.contrast)) {
+        append_set_target_number(cmd, sizeof(cmd), "target-contrast", t.contrast);
+        a->contrast = t.contrast;
+    }
+    if (all || strcmp(a->prim, t.prim) != 0) {
+        append_set_target(cmd, sizeof(cmd), "target-prim", t.prim);
+        a->prim = t.prim;
+    }
+    if (all || strcmp(a->trc, t.trc) != 0) {
+        append_set_target(cmd, sizeof(cmd), "target-trc", t.trc);
+        a->trc = t.trc;
     }
 
-    char json[8192];
-    size_t json_len = 0;
-    json[0] = '[';
-    json_len = 1;
+    if (cmd[0]) {
+        mpv_print("Applying tone-mapping targets for %s", r->name);
+        if (mpv_command_string(mpv, cmd) < 0) {
+            mpv_print("Failed to apply tone-mapping targets");
+            g_targets_applied = false;
+            return;
+        }
+    } else if (strcmp(g_applied_uid, r->uid) != 0) {
+        mpv_print("Tone-mapping targets unchanged after moving to %s", r->name);
+    }
 
-    char current_json[1024];
-    strcpy_s(current_json, sizeof(current_json), "{}");
+    snprintf(g_applied_uid, sizeof(g_applied_uid), "%s", r->uid);
+    g_targets_applied = true;
+}
 
-    for (UINT32 i = 0; i < pathCount; i++) {
-        DISPLAYCONFIG_PATH_INFO *path = &paths[i];
-
-        HMONITOR hMonitor = get_hm_from_display_path(path, modes, modeCount);
-        if (!hMonitor) continue;
-
-        for (UINT32 j = 0; j < modeCount; j++) {
-            if (modes[j].infoType == DISPLAYCONFIG_MODE_INFO_TYPE_TARGET &&
-                modes[j].id == path->targetInfo.id &&
-                modes[j].adapterId.HighPart == path->targetInfo.adapterId.HighPart &&
-                modes[j].adapterId.LowPart == path->targetInfo.adapterId.LowPart) {
-
-                DISPLAYCONFIG_MODE_INFO *mode = &modes[j];
-
-                char uid[64];
-                snprintf(uid, sizeof(uid), "%u", mode->id);
-
-                char name[128] = "Unknown";
-                GetMonitorName(mode, name, sizeof(name));
-                if (name[0] == '\0')
-                    snprintf(name, sizeof(name), "Unknown");
-
-                UINT32 bitDepth = 0;
-                HDR_STATUS status = GetDisplayHDRStatusAndBitDepth(mode, &bitDepth);
-
-                UINT32 width = 0, height = 0;
-                float refresh = 0.0f;
-                for (UINT32 k = 0; k < modeCount; k++) {
-                    if (modes[k].infoType == DISPLAYCONFIG_MODE_INFO_TYPE_SOURCE &&
-                        modes[k].id == path->sourceInfo.id &&
-                        modes[k].adapterId.HighPart == path->sourceInfo.adapterId.HighPart &&
-                        modes[k].adapterId.LowPart == path->sourceInfo.adapterId.LowPart) {
-                        DISPLAYCONFIG_SOURCE_MODE *src = &modes[k].sourceMode;
-                        width = src->width;
-                        height = src->height;
-                        if (path->targetInfo.refreshRate.Denominator != 0)
-                            refresh = path->targetInfo.refreshRate.Numerator / (float)path->targetInfo.refreshRate.Denominator;
-                        break;
-                    }
-                }
+static bool parse_opt_bool(const char *value) {
+    return strcmp(value, "yes") == 0 || strcmp(value, "true") == 0 || strcmp(value, "1") == 0;
+}
 
-                const char *tech = "Unknown";
-                switch (path->targetInfo.outputTechnology) {
-                    case DISPLAYCONFIG_OUTPUT_TECHNOLOGY_HDMI: tech = "HDMI"; break;
-                    case DISPLAYCONFIG_OUTPUT_TECHNOLOGY_DISPLAYPORT_EXTERNAL: tech = "DisplayPort"; break;
-                    case DISPLAYCONFIG_OUTPUT_TECHNOLOGY_DISPLAYPORT_EMBEDDED: tech = "eDP"; break;
-                    case DISPLAYCONFIG_OUTPUT_TECHNOLOGY_DVI: tech = "DVI"; break;
-                    case DISPLAYCONFIG_OUTPUT_TECHNOLOGY_INTERNAL: tech = "Internal"; break;
-                    default: break;
-                }
+static void load_script_opts(const mpv_node *node) {
+    if (!node || node->format != MPV_FORMAT_NODE_MAP)
+        return;
 
-                float max_luminance_val = 0.0f;
-                float min_luminance_val = 0.0f;
-                float max_full_frame_luminance_val = 0.0f;
-                const char *dxgi_primaries_str = "Unknown";
-                const char *dxgi_transfer_str = "Unknown";
-                DXGI_OUTPUT_DESC1 dxgi_desc1;
-                if (get_dxgi_output_desc1_for_monitor(hMonitor, &dxgi_desc1)) {
-                    max_luminance_val = dxgi_desc1.MaxLuminance;
-                    min_luminance_val = dxgi_desc1.MinLuminance;
-                    max_full_frame_luminance_val = dxgi_desc1.MaxFullFrameLuminance;
-                    dxgi_primaries_str = dxgi_primaries_to_str_local(dxgi_desc1.ColorSpace);
-                    dxgi_transfer_str = dxgi_transfer_to_str_local(dxgi_desc1.ColorSpace);
-                    mpv_print("DXGI Info: MaxL:%.2f, MinL:%.4f, Prim:%s, Trans:%s",
-                              max_luminance_val, min_luminance_val, dxgi_primaries_str, dxgi_transfer_str);
-                } else {
-                    mpv_print("Failed to get DXGI_OUTPUT_DESC1 for monitor.");
-                }
+    AcquireSRWLockExclusive(&g_display_lock);
 
-                bool is_current = false;
-                MONITORINFOEX monInfo = { .cbSize = sizeof(monInfo) };
-                if (GetMonitorInfo(current_monitor, (MONITORINFO*)&monInfo)) {
-                    DISPLAYCONFIG_SOURCE_DEVICE_NAME sourceName = {
-                        .header = {
-                            .type = DISPLAYCONFIG_DEVICE_INFO_GET_SOURCE_NAME,
-                            .size = sizeof(sourceName),
-                            .adapterId = path->sourceInfo.adapterId,
-                            .id = path->sourceInfo.id
-                        }
-                    };
-                    if (DisplayConfigGetDeviceInfo(&sourceName.header) == ERROR_SUCCESS) {
-                        wchar_t szDeviceW[32];
-                        MultiByteToWideChar(CP_ACP, 0, monInfo.szDevice, -1, szDeviceW, 32);
-                        if (wcscmp(szDeviceW, sourceName.viewGdiDeviceName) == 0) {
-                            is_current = true;
-
-                            snprintf(current_json, sizeof(current_json),
-                                "{\"name\":\"%s\",\"uid\":\"%s\",\"current\":true,\"hdr_supported\":%s,\"hdr_status\":\"%s\","
-                                "\"width\":%u,\"height\":%u,\"refresh_rate\":%.2f,\"bit_depth\":%u,"
-                                "\"primaries\":\"%s\",\"transfer\":\"%s\","
-                                "\"max_luminance\":%.2f,\"min_luminance\":%.4f,\"max_full_frame_luminance\":%.4f,"
-                                "\"technology\":\"%s\"}",
-                                name, uid,
-                                (status == HDR_STATUS_UNSUPPORTED ? "false" : "true"),
-                                hdr_status_to_str(status),
-                                width, height, refresh, bitDepth,
-                                dxgi_primaries_str, dxgi_transfer_str,
-                                max_luminance_val, min_luminance_val, max_full_frame_luminance_val,
-                                tech);
-
-                            mpv_set_property_string(mpv, "user-data/display-info/name", name);
-                            mpv_set_property_string(mpv, "user-data/display-info/uid", uid);
-                            mpv_set_property_string(mpv, "user-data/display-info/hdr-supported", (status == HDR_STATUS_UNSUPPORTED) ? "false" : "true");
-                            mpv_set_property_string(mpv, "user-data/display-info/hdr-status", hdr_status_to_str(status));
-
-                            char temp_str[32];
-                            snprintf(temp_str, sizeof(temp_str), "%u", bitDepth);
-                            mpv_set_property_string(mpv, "user-data/display-info/bit-depth", temp_str);
-                            snprintf(temp_str, sizeof(temp_str), "%.2f", refresh);
-                            mpv_set_property_string(mpv, "user-data/display-info/refresh-rate", temp_str);
-                            snprintf(temp_str, sizeof(temp_str), "%.2f", max_luminance_val);
-                            mpv_set_property_string(mpv, "user-data/display-info/max-luminance", temp_str);
-                            snprintf(temp_str, sizeof(temp_str), "%.4f", min_luminance_val);
-                            mpv_set_property_string(mpv, "user-data/display-info/min-luminance", temp_str);
-                            snprintf(temp_str, sizeof(temp_str), "%.4f", max_full_frame_luminance_val);
-                            mpv_set_property_string(mpv, "user-data/display-info/max-full-frame-luminance", temp_str);
-                            mpv_set_property_string(mpv, "user-data/display-info/primaries", dxgi_primaries_str);
-                            mpv_set_property_string(mpv, "user-data/display-info/transfer", dxgi_transfer_str);
-
-                            mpv_print("Display: %s, HDR: %s", name, hdr_status_to_str(status));
-                        }
-                    }
-                }
+    // Options missing from script-opts fall back to their defaults
+    bool was_enabled = g_opts.apply_targets;
+    g_opts = default_opts;
 
-                if (json_len < sizeof(json) - 1) {
-                    if (json_len > 1) {
-                        json[json_len++] = ',';
-                        json[json_len] = '\0';
-                    }
-                    int written = snprintf(json + json_len, sizeof(json) - json_len,
-                        "{\"name\":\"%s\",\"uid\":\"%s\",\"current\":%s, \"hdr_supported\":%s,\"hdr_status\":\"%s\","
-                        "\"width\":%u,\"height\":%u,\"refresh_rate\":%.2f,\"bit_depth\":%d,"
-                        "\"primaries\":\"%s\",\"transfer\":\"%s\","
-                        "\"max_luminance\":%.2f,\"min_luminance\":%.4f,\"max_full_frame_luminance\":%.4f,"
-                        "\"technology\":\"%s\"}",
-                        name, uid, is_current ? "true" : "false",
-                        (status == HDR_STATUS_UNSUPPORTED ? "false" : "true"),
-                        hdr_status_to_str(status),
-                        width, height, refresh, bitDepth,
-                        dxgi_primaries_str, dxgi_transfer_str,
-                        max_luminance_val, min_luminance_val, max_full_frame_luminance_val,
-                        tech);
-                    if (written > 0 && (size_t)written < sizeof(json) - json_len) {
-                        json_len += (size_t)written;
-                    } else {
-                        mpv_print("Warning: json buffer overflow");
-                        break;
-                    }
-                }
+    mpv_node_list *list = node->u.list;
+    for (int i = 0; i < list->num; i++) {
+        const char *key = list->keys[i];
+        if (list->values[i].format != MPV_FORMAT_STRING)
+            continue;
+        const char *value = list->values[i].u.string;
+
+        if (strcmp(key, "display-info-apply-targets") == 0) {
+            g_opts.apply_targets = parse_opt_bool(value);
+        } else if (strcmp(key, "display-info-target-tolerance") == 0) {
+            char *end = NULL;
+            double tolerance = strtod(value, &end);
+            if (end != value && tolerance >= 0.0)
+                g_opts.target_tolerance = tolerance;
+            else
+                mpv_print("Invalid display-info-target-tolerance: %s", value);
+        } else if (strcmp(key, "display-info-probe-timeout") == 0) {
+            char *end = NULL;
+            long timeout = strtol(value, &end, 10);
+            if (end != value && timeout > 0)
+                g_opts.probe_timeout_ms = (DWORD)timeout;
+            else
+                mpv_print("Invalid display-info-probe-timeout: %s", value);
+        }
+    }
+
+    // Put back the values the options had before the mode was switched on
+    if (!g_opts.apply_targets && was_enabled && g_targets_saved) {
+        char cmd[512] = "";
+        for (size_t i = 0; i < TARGET_OPTION_COUNT; i++) {
+            if (g_saved_targets[i][0])
+                append_set_target(cmd, sizeof(cmd), target_options[i], g_saved_targets[i]);
+        }
+        if (cmd[0] && mpv_command_string(mpv, cmd) < 0)
+            mpv_print("Failed to restore tone-mapping targets");
+        g_targets_applied = false;
+        g_targets_saved = false;
+    }
 
+    // Start from a clean slate whenever the mode is switched on
+    if (g_opts.apply_targets && !was_enabled) {
+        g_targets_applied = false;
+        for (size_t i = 0; i < g_display_count; i++) {
+            if (g_displays[i].record.current) {
+                apply_tone_mapping_targets(&g_displays[i].record);
                 break;
             }
         }
     }
 
-    if (json_len < sizeof(json) - 1) {
-        json[json_len++] = ']';
-        json[json_len] = '\0';
-    } else {
-        mpv_print("Warning: json buffer full, appending closing bracket failed");
-        if (json_len > 0)
-            json[json_len - 1] = ']';
+    ReleaseSRWLockExclusive(&g_display_lock);
+}
+
+enum {
+    HDR_REQUEST_NONE = -2,
+    HDR_REQUEST_TOGGLE = -1,
+    HDR_REQUEST_OFF = 0,
+    HDR_REQUEST_ON = 1,
+};
+
+// State of the probe worker, guarded by g_probe_lock. Lock order is
+// g_display_lock before g_probe_lock.
+static SRWLOCK g_probe_lock = SRWLOCK_INIT;
+static CONDITION_VARIABLE g_probe_cv = CONDITION_VARIABLE_INIT;
+static HANDLE g_probe_thread = NULL;
+static uint64_t g_probe_requested = 0;
+static uint64_t g_probe_completed = 0;
+// Newest refresh whose snapshot reached mpv, guarded by g_display_lock
+static uint64_t g_probe_published = 0;
+static bool g_probe_overdue = false;
+static bool g_probe_quit = false;
+// Pending toggle-hdr-display request, run by the probe worker before its next refresh
+static int g_hdr_request = HDR_REQUEST_NONE;
+
+static bool probe_shutting_down() {
+    AcquireSRWLockShared(&g_probe_lock);
+    bool quit = g_probe_quit;
+    ReleaseSRWLockShared(&g_probe_lock);
+    return quit;
+}
+
+static void publish_probe_timeouts() {
+    json_writer w = {0};
+    json_begin_object(&w);
+    for (int i = PROBE_NONE + 1; i < PROBE_COUNT; i++)
+        json_kv_uint(&w, probe_names[i], g_probe_timeouts[i]);
+    json_end_object(&w);
+    if (!w.failed)
+        mpv_set_property_string(mpv, "user-data/display-list/probe-timeouts", json_str(&w));
+    json_free(&w);
+}
+
+typedef struct {
+    const DISPLAYCONFIG_PATH_INFO *paths;
+    DISPLAYCONFIG_MODE_INFO *modes;
+    UINT32 modeCount;
+    const wchar_t *current_device;
+    display_entry *entries;
+    bool *probed;
+} probe_job;
+
+static void probe_display_task(void *ctx, size_t index, int worker) {
+    probe_job *job = ctx;
+    job->probed[index] = probe_display(worker, &job->paths[index], job->modes, job->modeCount,
+                                       job->current_device, &job->entries[index].record);
+    set_probe_stage(worker, PROBE_NONE);
+}
+
+static void update_display_list(uint64_t generation) {
+    HMONITOR current_monitor = GetWindowMonitor(hwnd);
+
+    set_probe_stage(0, PROBE_QUERY_CONFIG);
+    UINT32 pathCount = 0, modeCount = 0;
+    DISPLAYCONFIG_PATH_INFO *paths = NULL;
+    DISPLAYCONFIG_MODE_INFO *modes = NULL;
+    if (!g_probe_backend->query_config(&paths, &pathCount, &modes, &modeCount))
+        return;
+
+    wchar_t current_device[32];
+    bool have_current = false;
+    MONITORINFOEX monInfo = { .cbSize = sizeof(monInfo) };
+    if (GetMonitorInfo(current_monitor, (MONITORINFO*)&monInfo)) {
+        MultiByteToWideChar(CP_ACP, 0, monInfo.szDevice, -1, current_device, 32);
+        have_current = true;
     }
 
-    mpv_set_property_string(mpv, "user-data/display-list/full", json);
-    mpv_set_property_string(mpv, "user-data/display-list/current", current_json);
+    display_entry *entries = calloc(pathCount ? pathCount : 1, sizeof(*entries));
+    bool *probed = calloc(pathCount ? pathCount : 1, sizeof(*probed));
+    if (!entries || !probed) {
+        free(entries);
+        free(probed);
+        free(paths);
+        free(modes);
+        return;
+    }
+
+    // Displays are probed independently on the pool and without holding the
+    // table lock, a slow driver must not block readers. Results land in path
+    // order so the published list stays deterministic.
+    set_probe_stage(0, PROBE_NONE);
+    probe_job job = {
+        .paths = paths,
+        .modes = modes,
+        .modeCount = modeCount,
+        .current_device = have_current ? current_device : NULL,
+        .entries = entries,
+        .probed = probed,
+    };
+    pool_run(pathCount, g_probe_workers, probe_display_task, &job);
+
+    size_t count = 0;
+    for (UINT32 i = 0; i < pathCount; i++) {
+        if (probed[i])
+            entries[count++].record = entries[i].record;
+    }
 
+    free(probed);
     free(paths);
     free(modes);
+
+    AcquireSRWLockExclusive(&g_display_lock);
+
+    if (probe_shutting_down()) {
+        ReleaseSRWLockExclusive(&g_display_lock);
+        free(entries);
+        return;
+    }
+
+    // Reuse the cached fragment of every display whose record is unchanged
+    for (size_t i = 0; i < count; i++) {
+        display_entry *e = &entries[i];
+        display_entry *cached = find_cached_display(&e->record);
+        if (cached && cached->fragment.len && !cached->fragment.failed && display_record_equal(&cached->record, &e->record)) {
+            e->fragment = cached->fragment;
+            cached->fragment = (json_writer){0};
+        } else {
+            render_display_fragment(&e->record, &e->fragment);
+        }
+    }
+
+    for (size_t i = 0; i < g_display_count; i++)
+        json_free(&g_displays[i].fragment);
+    free(g_displays);
+    g_displays = entries;
+    g_display_count = count;
+
+    json_writer list = {0};
+    const display_entry *current = NULL;
+    json_raw(&list, "[", 1);
+    for (size_t i = 0; i < count; i++) {
+        if (i > 0) json_raw(&list, ",", 1);
+        if (g_displays[i].fragment.failed)
+            list.failed = true;
+        json_raw(&list, g_displays[i].fragment.data, g_displays[i].fragment.len);
+        if (g_displays[i].record.current && !current)
+            current = &g_displays[i];
+    }
+    json_raw(&list, "]", 1);
+
+    // On allocation failure keep the previously published JSON rather than a truncated one
+    if (!list.failed)
+        mpv_set_property_string(mpv, "user-data/display-list/full", json_str(&list));
+    else
+        mpv_print("Failed to render display list, keeping previous value");
+    if (!current)
+        mpv_set_property_string(mpv, "user-data/display-list/current", "{}");
+    else if (!current->fragment.failed)
+        mpv_set_property_string(mpv, "user-data/display-list/current", json_str(&current->fragment));
+    mpv_set_property_string(mpv, "user-data/display-list/stale", "false");
+    g_probe_published = generation;
+    if (current) {
+        publish_current_display(&current->record);
+        apply_tone_mapping_targets(&current->record);
+    }
+
+    ReleaseSRWLockExclusive(&g_display_lock);
+
+    json_free(&list);
 }
 
-static void update_mpv_properties() {
-    mpv_print("Updating display properties...");
+static void show_message(const char *text) {
+    AcquireSRWLockExclusive(&g_display_lock);
+    if (!probe_shutting_down())
+        mpv_command_string(mpv, text);
+    ReleaseSRWLockExclusive(&g_display_lock);
+}
+
+static void toggle_hdr_display(int request) {
+    set_probe_stage(0, PROBE_HDR_TOGGLE);
 
     DISPLAYCONFIG_MODE_INFO mode;
     if (!GetDisplayConfigForMonitor(GetWindowMonitor(hwnd), &mode)) {
-        mpv_print("Failed to get display mode");
+        show_message("print-text \"[display-info] Failed to get display mode for toggle\"");
+        set_probe_stage(0, PROBE_NONE);
+        return;
+    }
+
+    UINT32 bit_depth = 0;
+    HDR_STATUS current = GetDisplayHDRStatusAndBitDepth(&mode, &bit_depth);
+    if (current == HDR_STATUS_UNSUPPORTED) {
+        show_message("print-text \"[display-info] HDR unsupported, cannot toggle\"");
+        set_probe_stage(0, PROBE_NONE);
         return;
     }
 
-    update_display_list();
+    bool target_on = (request == HDR_REQUEST_TOGGLE) ? (current != HDR_STATUS_ON) : (request == HDR_REQUEST_ON);
+
+    HDR_STATUS new_status;
+    if (SetDisplayHDRStatus(&mode, target_on, &new_status)) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "print-text \"[display-info] HDR %s\"",
+                 new_status == HDR_STATUS_ON ? "enabled" : "disabled");
+        show_message(msg);
+    } else {
+        show_message("print-text \"[display-info] Failed to change HDR status\"");
+    }
+    set_probe_stage(0, PROBE_NONE);
+}
+
+// Runs refreshes one at a time; requests that arrive while one is running
+// are coalesced into a single follow-up refresh.
+static DWORD WINAPI ProbeThreadProc(LPVOID lpParam) {
+    AcquireSRWLockExclusive(&g_probe_lock);
+    while (!g_probe_quit) {
+        if (g_probe_completed == g_probe_requested) {
+            SleepConditionVariableSRW(&g_probe_cv, &g_probe_lock, INFINITE, 0);
+            continue;
+        }
+
+        uint64_t generation = g_probe_requested;
+        int hdr_request = g_hdr_request;
+        g_hdr_request = HDR_REQUEST_NONE;
+        g_probe_overdue = false;
+        ReleaseSRWLockExclusive(&g_probe_lock);
+
+        // A toggle is part of the run, so it shares the refresh deadline
+        if (hdr_request != HDR_REQUEST_NONE)
+            toggle_hdr_display(hdr_request);
+        update_display_list(generation);
+
+        AcquireSRWLockExclusive(&g_probe_lock);
+        g_probe_completed = generation;
+        WakeAllConditionVariable(&g_probe_cv);
+    }
+    ReleaseSRWLockExclusive(&g_probe_lock);
+
+    return 0;
+}
+
+// Keeps the last good snapshot published but flags it, the probe worker
+// replaces it once the overdue refresh finishes.
+static void mark_display_list_stale(uint64_t generation) {
+    AcquireSRWLockExclusive(&g_display_lock);
+    // The worker may have published the refresh between the deadline and here
+    if (g_probe_published < generation && !probe_shutting_down()) {
+        for (int i = 0; i < POOL_MAX_WORKERS; i++) {
+            LONG stage = g_probe_stages[i];
+            if (stage > PROBE_NONE && stage < PROBE_COUNT) {
+                g_probe_timeouts[stage]++;
+                mpv_print("Probe %s exceeded its deadline", probe_names[stage]);
+            }
+        }
+        mpv_set_property_string(mpv, "user-data/display-list/stale", "true");
+        publish_probe_timeouts();
+    }
+    ReleaseSRWLockExclusive(&g_display_lock);
+}
+
+static void update_mpv_properties() {
+    mpv_print("Updating display properties...");
+
+    AcquireSRWLockShared(&g_display_lock);
+    DWORD timeout_ms = g_opts.probe_timeout_ms;
+    ReleaseSRWLockShared(&g_display_lock);
+
+    AcquireSRWLockExclusive(&g_probe_lock);
+    if (g_probe_quit || !g_probe_thread) {
+        ReleaseSRWLockExclusive(&g_probe_lock);
+        return;
+    }
+
+    uint64_t generation = ++g_probe_requested;
+    WakeAllConditionVariable(&g_probe_cv);
+
+    // Once a refresh has missed its deadline, don't stall the caller again
+    // until the worker has caught up
+    bool timed_out = false;
+    if (!g_probe_overdue) {
+        ULONGLONG deadline = GetTickCount64() + timeout_ms;
+        while (g_probe_completed < generation && !g_probe_quit) {
+            ULONGLONG now = GetTickCount64();
+            if (now >= deadline)
+                break;
+            SleepConditionVariableSRW(&g_probe_cv, &g_probe_lock, (DWORD)(deadline - now), 0);
+        }
+        if (g_probe_completed < generation && !g_probe_quit) {
+            g_probe_overdue = true;
+            timed_out = true;
+        }
+    }
+    ReleaseSRWLockExclusive(&g_probe_lock);
+
+    if (timed_out)
+        mark_display_list_stale(generation);
+}
+
+static void start_probe_thread() {
+    g_probe_thread = CreateThread(NULL, 0, ProbeThreadProc, NULL, 0, NULL);
+    if (!g_probe_thread)
+        mpv_print("Failed to create probe thread");
+}
+
+static void stop_probe_thread() {
+    // Holding the table lock guarantees no publish is in flight once quit is set
+    AcquireSRWLockExclusive(&g_display_lock);
+    AcquireSRWLockExclusive(&g_probe_lock);
+    g_probe_quit = true;
+    WakeAllConditionVariable(&g_probe_cv);
+    ReleaseSRWLockExclusive(&g_probe_lock);
+    ReleaseSRWLockExclusive(&g_display_lock);
+
+    if (g_probe_thread) {
+        // A probe stuck in the driver is abandoned rather than waited on
+        WaitForSingleObject(g_probe_thread, g_opts.probe_timeout_ms);
+        CloseHandle(g_probe_thread);
+        g_probe_thread = NULL;
+    }
 }
 
 static void plugin_init(int64_t wid) {
@@ -608,6 +1349,11 @@ static void handle_property_change(mpv_event *event) {
         mpv_print("Display names changed");
         update_mpv_properties();
     }
+
+    if (prop->format == MPV_FORMAT_NODE &&
+        strcmp(prop->name, "options/script-opts") == 0) {
+        load_script_opts(prop->data);
+    }
 }
 
 static void handle_client_message(mpv_event *event) {
@@ -619,45 +1365,26 @@ static void handle_client_message(mpv_event *event) {
 
     mpv_print("Received toggle-hdr-display message\n");
 
-    int set_status = -1; // -1: toggle, 0: off, 1: on
+    int request = HDR_REQUEST_TOGGLE;
     if (msg->num_args >= 2) {
         const char *arg = msg->args[1];
         if (strcmp(arg, "on") == 0) {
-            set_status = 1;
+            request = HDR_REQUEST_ON;
         } else if (strcmp(arg, "off") == 0) {
-            set_status = 0;
+            request = HDR_REQUEST_OFF;
         } else {
             mpv_command_string(mpv, "print-text \"[display-info] Invalid argument. Use: toggle-hdr-display [on|off]\"");
             return;
         }
     }
 
-    DISPLAYCONFIG_MODE_INFO mode;
-    if (!GetDisplayConfigForMonitor(GetWindowMonitor(hwnd), &mode)) {
-        mpv_command_string(mpv, "print-text \"[display-info] Failed to get display mode for toggle\"");
-        return;
-    }
-
-    UINT32 bit_depth = 0;
-    HDR_STATUS current = GetDisplayHDRStatusAndBitDepth(&mode, &bit_depth);
-    if (current == HDR_STATUS_UNSUPPORTED) {
-        mpv_command_string(mpv, "print-text \"[display-info] HDR unsupported, cannot toggle\"");
-        return;
-    }
-
-    bool target_on = (set_status == -1) ? (current != HDR_STATUS_ON) : (set_status == 1);
-
-    HDR_STATUS new_status;
-    if (SetDisplayHDRStatus(&mode, target_on, &new_status)) {
-        update_mpv_properties();
+    // The driver calls run on the probe worker under the refresh deadline, a
+    // toggle issued during a driver reset completes once the driver responds
+    AcquireSRWLockExclusive(&g_probe_lock);
+    g_hdr_request = request;
+    ReleaseSRWLockExclusive(&g_probe_lock);
 
-        char msg[128];
-        snprintf(msg, sizeof(msg), "print-text \"[display-info] HDR %s\"", 
-                 new_status == HDR_STATUS_ON ? "enabled" : "disabled");
-        mpv_command_string(mpv, msg);
-    } else {
-        mpv_command_string(mpv, "print-text \"[display-info] Failed to change HDR status\"");
-    }
+    update_mpv_properties();
 }
 
 static LRESULT CALLBACK MessageWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
@@ -705,8 +1432,10 @@ MPV_EXPORT int mpv_open_cplugin(mpv_handle *handle) {
     mpv = handle;
     mpv_observe_property(mpv, 0, "window-id", MPV_FORMAT_INT64);
     mpv_observe_property(mpv, 0, "display-names", MPV_FORMAT_NODE);
+    mpv_observe_property(mpv, 0, "options/script-opts", MPV_FORMAT_NODE);
     mpv_request_event(mpv, MPV_EVENT_CLIENT_MESSAGE, 1);
 
+    start_probe_thread();
     CreateThread(NULL, 0, MessageThreadProc, NULL, 0, NULL);
 
     mpv_print("Plugin loaded and waiting for events...");
@@ -728,6 +1457,7 @@ MPV_EXPORT int mpv_open_cplugin(mpv_handle *handle) {
     }
 
     mpv_print("Plugin shutting down");
+    stop_probe_thread();
     mpv_unobserve_property(mpv, 0);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,62 @@
+// Copyright (c) 2023 dyphire. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include "pool.h"
+
+typedef struct {
+    pool_task_fn fn;
+    void *ctx;
+    size_t count;
+    volatile LONG next;
+} pool_job;
+
+typedef struct {
+    pool_job *job;
+    int worker;
+} pool_worker;
+
+static void pool_drain(pool_job *job, int worker) {
+    for (;;) {
+        size_t index = (size_t)(InterlockedIncrement(&job->next) - 1);
+        if (index >= job->count)
+            break;
+        job->fn(job->ctx, index, worker);
+    }
+}
+
+static DWORD WINAPI PoolThreadProc(LPVOID lpParam) {
+    pool_worker *w = lpParam;
+    pool_drain(w->job, w->worker);
+    return 0;
+}
+
+void pool_run(size_t count, int workers, pool_task_fn fn, void *ctx) {
+    pool_job job = { .fn = fn, .ctx = ctx, .count = count, .next = 0 };
+
+    if (workers > POOL_MAX_WORKERS)
+        workers = POOL_MAX_WORKERS;
+    if ((size_t)workers > count)
+        workers = (int)count;
+
+    // Worker 0 is the calling thread, a failed CreateThread just means fewer helpers
+    pool_worker helpers[POOL_MAX_WORKERS];
+    HANDLE threads[POOL_MAX_WORKERS];
+    DWORD started = 0;
+    for (int i = 1; i < workers; i++) {
+        helpers[started] = (pool_worker){ .job = &job, .worker = i };
+        threads[started] = CreateThread(NULL, 0, PoolThreadProc, &helpers[started], 0, NULL);
+        if (threads[started])
+            started++;
+    }
+
+    pool_drain(&job, 0);
+
+    if (started) {
+        WaitForMultipleObjects(started, threads, TRUE, INFINITE);
+        for (DWORD i = 0; i < started; i++)
+            CloseHandle(threads[i]);
+    }
+}
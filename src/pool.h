@@ -0,0 +1,19 @@
+// Copyright (c) 2023 dyphire. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+#ifndef DISPLAY_POOL_H
+#define DISPLAY_POOL_H
+
+#include <stddef.h>
+
+// Upper bound on the threads used by a single pool_run call
+#define POOL_MAX_WORKERS 4
+
+// Called once per index, worker is in [0, workers) and stable for the call
+typedef void (*pool_task_fn)(void *ctx, size_t index, int worker);
+
+// Runs fn for every index in [0, count) on at most workers threads, the
+// calling thread included, and returns once every index has been processed.
+void pool_run(size_t count, int workers, pool_task_fn fn, void *ctx);
+
+#endif